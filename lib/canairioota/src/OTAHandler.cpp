@@ -11,32 +11,43 @@ void OTAHandler::setup(const char* ESP_ID, const char* ESP_PASS) {
 
   ArduinoOTA
       .onStart([]() {
-        Serial.printf("\r\n");
+        ota.getInstance()->message("[OTA] update started");
         if (ota.getInstance()->m_pOTAHandlerCallbacks != nullptr)
           ota.getInstance()->m_pOTAHandlerCallbacks->onStart();
       })
       .onEnd([]() {
-        Serial.println("\r\n[OTA] success!");
+        ota.getInstance()->message("[OTA] success!");
         if (ota.getInstance()->m_pOTAHandlerCallbacks != nullptr)
           ota.getInstance()->m_pOTAHandlerCallbacks->onEnd();
       })
       .onProgress([](unsigned int progress, unsigned int total) {
-        Serial.printf("\r[OTA] Progress: %u%%", (progress / (total / 100)));
+        // report every 10% to avoid flooding the consoles
+        static unsigned int last_step = 0;
+        unsigned int step = total ? (progress * 10ULL) / total : 0;
+        if (progress == 0 || step != last_step) {
+          char msg[32];
+          snprintf(msg, sizeof(msg), "[OTA] Progress: %u%%", step * 10);
+          ota.getInstance()->message(msg);
+          last_step = step;
+        }
         if (ota.getInstance()->m_pOTAHandlerCallbacks != nullptr)
           ota.getInstance()->m_pOTAHandlerCallbacks->onProgress(progress, total);
       })
       .onError([](ota_error_t error) {
-        Serial.printf("[E][OTA] Error[%u]: ", error);
+        const char* reason = "Unknown";
         if (error == OTA_AUTH_ERROR)
-          Serial.println("Auth Failed");
+          reason = "Auth Failed";
         else if (error == OTA_BEGIN_ERROR)
-          Serial.println("Begin Failed");
+          reason = "Begin Failed";
         else if (error == OTA_CONNECT_ERROR)
-          Serial.println("Connect Failed");
+          reason = "Connect Failed";
         else if (error == OTA_RECEIVE_ERROR)
-          Serial.println("Receive Failed");
+          reason = "Receive Failed";
         else if (error == OTA_END_ERROR)
-          Serial.println("End Failed");
+          reason = "End Failed";
+        char msg[48];
+        snprintf(msg, sizeof(msg), "[E][OTA] Error[%u]: %s", error, reason);
+        ota.getInstance()->message(msg);
         if (ota.getInstance()->m_pOTAHandlerCallbacks != nullptr)
           ota.getInstance()->m_pOTAHandlerCallbacks->onError();
       });
@@ -55,6 +66,13 @@ void OTAHandler::setCallbacks(OTAHandlerCallbacks* pCallbacks) {
 
 void OTAHandler::setOnUpdateMessageCb(voidMessageCbFn cb) { _onUpdateMsgCb = cb; }
 
+void OTAHandler::message(const char* msg) {
+  if (_onUpdateMsgCb != nullptr)
+    _onUpdateMsgCb(msg);
+  else
+    Serial.println(msg);
+}
+
 OTAHandler* OTAHandler::getInstance() { return this; }
 
 #if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_OTAHANDLER)
@@ -23,6 +23,7 @@ class OTAHandler {
   const char* _ESP_PASS;
   int _baud;
   void remoteOTAcheckloop();
+  void message(const char* msg);
 };
 
 class OTAHandlerCallbacks {
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Preferences.h>
 
 #include <cstring>
@@ -5,7 +7,20 @@
 
 #include "time.h"
 
+#define ALARM_NAME_MAX 32
+
+#define ALARM_NEVER_FIRED -1
+
 typedef void (*AlarmCallback)(const char* alarmName, const tm* timeinfo);
+typedef void (*AlarmSaveCallback)();
+
+// Fixed size alarm record, used to keep the schedule in RTC memory
+struct AlarmSnapshot {
+  int32_t firedDay;
+  uint8_t hour;
+  uint8_t minute;
+  char name[ALARM_NAME_MAX];
+};
 
 class AlarmManager {
  private:
@@ -13,11 +28,11 @@ class AlarmManager {
     int hour;
     int minute;
     const char* name;
-    bool triggered;
+    int32_t firedDay;  // local date of the last trigger, see dayOf()
 
     // Constructor that copies the string
     Alarm(int h, int m, const char* n)
-        : hour(h), minute(m), name(n ? strdup(n) : nullptr), triggered(false) {}
+        : hour(h), minute(m), name(n ? strdup(n) : nullptr), firedDay(ALARM_NEVER_FIRED) {}
 
     // Destructor to free memory
     ~Alarm() {
@@ -31,7 +46,7 @@ class AlarmManager {
         : hour(other.hour),
           minute(other.minute),
           name(strdup(other.name)),
-          triggered(other.triggered) {}
+          firedDay(other.firedDay) {}
 
     // Rule of Three: Copy assignment
     Alarm& operator=(const Alarm& other) {
@@ -40,13 +55,14 @@ class AlarmManager {
         hour = other.hour;
         minute = other.minute;
         name = strdup(other.name);
-        triggered = other.triggered;
+        firedDay = other.firedDay;
       }
       return *this;
     }
   };
   std::vector<Alarm> alarms;
   AlarmCallback callback = nullptr;
+  AlarmSaveCallback saveCallback = nullptr;
 
  public:
   void addDailyAlarm(int hour, int minute, const char* name) {
@@ -55,21 +71,49 @@ class AlarmManager {
 
   void setCallback(AlarmCallback cb) { callback = cb; }
 
+  // Called when an alarm fires, before the alarm callback, to persist the fired day
+  void setSaveCallback(AlarmSaveCallback cb) { saveCallback = cb; }
+
   // Get all alarms (const reference)
   const std::vector<Alarm>& getAlarms() const { return alarms; }
 
+  // Unique number for each local date
+  static int32_t dayOf(const tm* timeinfo) { return timeinfo->tm_year * 1000 + timeinfo->tm_yday; }
+
+  // Each alarm fires once per day. The day is kept instead of a flag, so it works
+  // even if no check happens at midnight (i.e. deep sleep or power off).
   void checkAlarms(const tm* timeinfo) {
+    int32_t today = dayOf(timeinfo);
     for (auto& alarm : alarms) {
-      if (!alarm.triggered && timeinfo->tm_hour == alarm.hour && timeinfo->tm_min == alarm.minute) {
-        alarm.triggered = true;
+      if (alarm.firedDay != today && timeinfo->tm_hour == alarm.hour &&
+          timeinfo->tm_min == alarm.minute) {
+        alarm.firedDay = today;
+        // Persist it first: a reset during the callback must not fire it again
+        if (saveCallback) saveCallback();
         if (callback) {
           callback(alarm.name, timeinfo);
         }
       }
-      // Reset trigger at midnight
-      else if (timeinfo->tm_hour == 0 && timeinfo->tm_min == 0) {
-        alarm.triggered = false;
-      }
+    }
+  }
+
+  // Copy the schedule into fixed records. Returns the alarm count, which may exceed max.
+  size_t snapshot(AlarmSnapshot* out, size_t max) const {
+    for (size_t i = 0; i < alarms.size() && i < max; i++) {
+      out[i].hour = alarms[i].hour;
+      out[i].minute = alarms[i].minute;
+      out[i].firedDay = alarms[i].firedDay;
+      strlcpy(out[i].name, alarms[i].name ? alarms[i].name : "", ALARM_NAME_MAX);
+    }
+    return alarms.size();
+  }
+
+  // Replace the schedule with fixed records, keeping the day of the last trigger
+  void restore(const AlarmSnapshot* in, size_t count) {
+    alarms.clear();
+    for (size_t i = 0; i < count; i++) {
+      alarms.emplace_back(in[i].hour, in[i].minute, in[i].name);
+      alarms.back().firedDay = in[i].firedDay;
     }
   }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #define WIFI_CONNECT_WAIT_MAX (30 * 1000)
+#define CLI_TELNET_PORT 11000  // ESP32WifiCLI Telnet shell port
 
 // change these params via CLI:
 #define DEFAULT_TZONE "CET-1CEST,M3.5.0,M10.5.0/3"
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+#include "alarm_manager.h"
+
+#define BOOT_STATE_MAGIC 0xBA5117A2  // change it when BootState layout changes
+#define BOOT_STATE_ALARMS_MAX 8
+#define BOOT_STATE_TZ_LEN 48
+#define BOOT_TIME_VALID_EPOCH 1704067200  // 2024-01-01, older clocks are not set
+#define BOOT_MARKS_MAX 8
+
+/**
+ * @brief State kept in RTC slow memory across reboots and deep sleep
+ * @details RTC_NOINIT memory is random after a power on, so the magic and the
+ * checksum decide if it can be trusted. Otherwise the boot falls back to NVS.
+ */
+struct BootState {
+  uint32_t magic;
+  uint32_t checksum;
+  time_t epoch;  // last known time, saved by the scheduler
+  char tzone[BOOT_STATE_TZ_LEN];
+  uint8_t alarmCount;
+  AlarmSnapshot alarms[BOOT_STATE_ALARMS_MAX];
+};
+
+RTC_NOINIT_ATTR BootState bootState;
+
+uint32_t bootStateChecksum() {
+  // FNV-1a over everything after the checksum field
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&bootState.epoch);
+  size_t len = sizeof(BootState) - offsetof(BootState, epoch);
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool isBootStateValid() {
+  return bootState.magic == BOOT_STATE_MAGIC && bootState.checksum == bootStateChecksum() &&
+         bootState.alarmCount <= BOOT_STATE_ALARMS_MAX;
+}
+
+/**
+ * @brief save the schedule and the current time to RTC memory
+ * @details The snapshot is invalidated if the schedule doesn't fit on it.
+ */
+void saveBootState(const AlarmManager &manager, const char *tzone) {
+  bootState.magic = 0;
+  size_t count = manager.snapshot(bootState.alarms, BOOT_STATE_ALARMS_MAX);
+  if (count > BOOT_STATE_ALARMS_MAX) return;
+  bootState.alarmCount = count;
+  bootState.epoch = time(nullptr);
+  strlcpy(bootState.tzone, tzone, BOOT_STATE_TZ_LEN);
+  bootState.checksum = bootStateChecksum();
+  bootState.magic = BOOT_STATE_MAGIC;
+}
+
+/**
+ * @brief restore the schedule, timezone and, if the clock was lost, the last known time
+ * @return false if there is no valid snapshot
+ */
+bool restoreBootState(AlarmManager &manager) {
+  if (!isBootStateValid()) return false;
+  manager.restore(bootState.alarms, bootState.alarmCount);
+  setenv("TZ", bootState.tzone, 1);
+  tzset();
+  // The RTC keeps the clock on soft resets and deep sleep, only fix it if it was lost.
+  if (time(nullptr) < BOOT_TIME_VALID_EPOCH && bootState.epoch >= BOOT_TIME_VALID_EPOCH) {
+    struct timeval tv = {bootState.epoch, 0};
+    settimeofday(&tv, nullptr);
+  }
+  return true;
+}
+
+/**
+ * @brief Boot phase timing instrumentation
+ * @details Each mark stores the time since the chip started, in microseconds.
+ */
+class BootTimer {
+ private:
+  const char *names[BOOT_MARKS_MAX];
+  int64_t marks[BOOT_MARKS_MAX];
+  uint8_t count = 0;
+
+ public:
+  void mark(const char *name) {
+    if (count >= BOOT_MARKS_MAX) return;
+    for (uint8_t i = 0; i < count; i++) {
+      if (strcmp(names[i], name) == 0) return;  // only the first occurrence
+    }
+    names[count] = name;
+    marks[count++] = esp_timer_get_time();
+  }
+
+  void print(Stream *response) const {
+    for (uint8_t i = 0; i < count; i++) {
+      int64_t delta = i ? marks[i] - marks[i - 1] : marks[i];
+      response->printf("%-12s\t%8.2f ms\t(+%.2f ms)\r\n", names[i], marks[i] / 1000.0,
+                       delta / 1000.0);
+    }
+  }
+};
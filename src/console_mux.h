@@ -0,0 +1,273 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lwip/sockets.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstring>
+
+// Console multiplexer tuning. Ring and queue sizes must be power of two.
+#ifndef CONSOLE_MSG_LEN
+#define CONSOLE_MSG_LEN 96
+#endif
+#ifndef CONSOLE_RING_SIZE
+#define CONSOLE_RING_SIZE 32
+#endif
+#ifndef CONSOLE_QUEUE_SIZE
+#define CONSOLE_QUEUE_SIZE 16
+#endif
+#ifndef CONSOLE_MAX_SESSIONS
+#define CONSOLE_MAX_SESSIONS 4  // Serial + 3 remote sessions
+#endif
+#ifndef CONSOLE_FLUSH_MAX
+#define CONSOLE_FLUSH_MAX 4  // messages written per session on each drain
+#endif
+#define CONSOLE_CHECK_INTERVAL 1000  // ms between remote sessions connection checks
+
+/**
+ * @brief Event log multiplexer for Serial and Telnet consoles
+ * @details Producers (alarms, pump, OTA, settings) only copy a line into a lock-free
+ * bounded ring and never touch a Stream. drain() runs from loop(), moves the pending
+ * lines into a bounded queue per attached session and writes a few lines per session.
+ * Nothing blocks: local streams (Serial) are written only when availableForWrite() has
+ * room for the line, and remote sessions are written on their socket with MSG_DONTWAIT,
+ * keeping the line queued on EAGAIN. A stalled session fills its queue and the oldest
+ * lines are dropped and counted. A remote session is detached when its peer goes away.
+ */
+class ConsoleMux {
+ private:
+  struct Line {
+    uint16_t len;
+    char text[CONSOLE_MSG_LEN];
+  };
+
+  // Bounded MPMC ring (sequence per slot), used here with a single consumer.
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    Line line;
+  };
+
+  struct Session {
+    Stream* out = nullptr;  // identifies the console, only written if fd < 0
+    int fd = -1;            // socket of a remote session
+    struct sockaddr_in peer;
+    Line queue[CONSOLE_QUEUE_SIZE];
+    uint16_t head = 0;
+    uint16_t count = 0;
+    uint16_t offset = 0;  // bytes of the head line already sent on the socket
+    uint32_t dropped = 0;
+  };
+
+  Slot ring[CONSOLE_RING_SIZE];
+  std::atomic<uint32_t> enqueuePos{0};
+  uint32_t dequeuePos = 0;
+  std::atomic<uint32_t> ringDropped{0};
+  Session sessions[CONSOLE_MAX_SESSIONS];
+  uint32_t lastCheck = 0;
+
+  static_assert((CONSOLE_RING_SIZE & (CONSOLE_RING_SIZE - 1)) == 0, "ring size must be 2^n");
+  static_assert((CONSOLE_QUEUE_SIZE & (CONSOLE_QUEUE_SIZE - 1)) == 0, "queue size must be 2^n");
+
+  bool pop(Line& line) {
+    Slot& slot = ring[dequeuePos & (CONSOLE_RING_SIZE - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != dequeuePos + 1) return false;
+    line = slot.line;
+    slot.seq.store(dequeuePos + CONSOLE_RING_SIZE, std::memory_order_release);
+    dequeuePos++;
+    return true;
+  }
+
+  void enqueue(Session& s, const Line& line) {
+    if (s.count == CONSOLE_QUEUE_SIZE) {
+      if (s.offset > 0) {  // the oldest line is half sent, drop the new one
+        s.dropped++;
+        return;
+      }
+      s.head = (s.head + 1) & (CONSOLE_QUEUE_SIZE - 1);  // evict the oldest line
+      s.count--;
+      s.dropped++;
+    }
+    s.queue[(s.head + s.count) & (CONSOLE_QUEUE_SIZE - 1)] = line;
+    s.count++;
+  }
+
+  static bool samePeer(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+  }
+
+  // The socket is still connected to the same client. Sockets are reused by new clients.
+  static bool isConnected(const Session& s) {
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(s.fd, (struct sockaddr*)&peer, &len) != 0) return false;
+    return samePeer(peer, s.peer);
+  }
+
+  void flush(Session& s) {
+    for (int i = 0; i < CONSOLE_FLUSH_MAX && s.count > 0; i++) {
+      const Line& line = s.queue[s.head];
+      if (s.fd < 0) {
+        if (s.out->availableForWrite() < line.len) return;  // keep it queued
+        s.out->write(reinterpret_cast<const uint8_t*>(line.text), line.len);
+      } else {
+        int sent = send(s.fd, line.text + s.offset, line.len - s.offset, MSG_DONTWAIT);
+        if (sent < 0) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK) s.out = nullptr;  // peer gone
+          return;  // keep it queued
+        }
+        s.offset += sent;
+        if (s.offset < line.len) return;
+        s.offset = 0;
+      }
+      s.head = (s.head + 1) & (CONSOLE_QUEUE_SIZE - 1);
+      s.count--;
+    }
+  }
+
+ public:
+  ConsoleMux() {
+    for (uint32_t i = 0; i < CONSOLE_RING_SIZE; i++) ring[i].seq.store(i);
+  }
+
+  /**
+   * @brief find the connected client socket of a TCP server
+   * @return the socket, or -1 if there is none or more than one client
+   */
+  static int findClientSocket(uint16_t localPort) {
+    int found = -1;
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+      struct sockaddr_in addr;
+      socklen_t len = sizeof(addr);
+      if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0) continue;
+      if (ntohs(addr.sin_port) != localPort) continue;
+      len = sizeof(addr);
+      if (getpeername(fd, (struct sockaddr*)&addr, &len) != 0) continue;  // the listener
+      if (found >= 0) return -1;
+      found = fd;
+    }
+    return found;
+  }
+
+  /**
+   * @brief attach a console
+   * @param out the console stream. It must report its free space with availableForWrite(),
+   * unless a socket is given.
+   * @param fd the client socket of a remote session, written with non-blocking sends
+   * @return false if the session table is full or the socket is not connected
+   */
+  bool attach(Stream* out, int fd = -1) {
+    prune();
+    Session* empty = nullptr;
+    for (auto& s : sessions) {
+      if (s.out == out) return true;
+      if (!s.out && !empty) empty = &s;
+    }
+    if (!empty) return false;
+    if (fd >= 0) {
+      socklen_t len = sizeof(empty->peer);
+      if (getpeername(fd, (struct sockaddr*)&empty->peer, &len) != 0) return false;
+    }
+    empty->fd = fd;
+    empty->head = 0;
+    empty->count = 0;
+    empty->offset = 0;
+    empty->dropped = 0;
+    empty->out = out;
+    return true;
+  }
+
+  /**
+   * @brief detach remote sessions whose client is gone
+   */
+  void prune() {
+    lastCheck = millis();
+    for (auto& s : sessions) {
+      if (s.out && s.fd >= 0 && !isConnected(s)) s.out = nullptr;
+    }
+  }
+
+  void detach(Stream* out) {
+    for (auto& s : sessions) {
+      if (s.out == out) s.out = nullptr;
+    }
+  }
+
+  bool isAttached(Stream* out) {
+    prune();
+    for (const auto& s : sessions) {
+      if (s.out == out) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief push a line to the log. Never blocks, drops the line if the ring is full.
+   * @details Safe to call from any task. A CRLF is appended.
+   */
+  bool println(const char* msg) {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &ring[pos & (CONSOLE_RING_SIZE - 1)];
+      int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        ringDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    size_t len = strnlen(msg, CONSOLE_MSG_LEN - 3);
+    memcpy(slot->line.text, msg, len);
+    slot->line.text[len++] = '\r';
+    slot->line.text[len++] = '\n';
+    slot->line.text[len] = '\0';
+    slot->line.len = len;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  __attribute__((format(printf, 2, 3))) bool printf(const char* format, ...) {
+    char buf[CONSOLE_MSG_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return println(buf);
+  }
+
+  /**
+   * @brief fan out pending lines to all sessions. Never blocks.
+   * @details Single consumer: call it only from the loop task (loop() or its callbacks).
+   */
+  void drain() {
+    if (millis() - lastCheck > CONSOLE_CHECK_INTERVAL) prune();
+    Line line;
+    while (pop(line)) {
+      for (auto& s : sessions) {
+        if (s.out) enqueue(s, line);
+      }
+    }
+    for (auto& s : sessions) {
+      if (s.out) flush(s);
+    }
+  }
+
+  uint32_t getRingDropped() const { return ringDropped.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief print the session table and drop counters
+   */
+  void printStatus(Stream* response) const {
+    response->printf("ring drops: \t%u\r\n", (unsigned)getRingDropped());
+    for (const auto& s : sessions) {
+      if (!s.out) continue;
+      response->printf("session %s: \tqueued %u, dropped %u\r\n",
+                       s.fd < 0 ? "local" : "remote", s.count, (unsigned)s.dropped);
+    }
+  }
+};
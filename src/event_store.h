@@ -0,0 +1,273 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+
+#include <mutex>
+
+#define EVENTS_PARTITION_LABEL "events"  // data partition, see partitions_*.csv
+#define EVENTS_SECTOR_SIZE 4096
+#define EVENTS_SECTOR_MAGIC 0x45564E54  // "EVNT"
+#ifndef EVENTS_SECTORS
+#define EVENTS_SECTORS 16  // 64KB, about 5400 events
+#endif
+#define EVENTS_EARLY_MAX 8  // events kept in RAM until the log is mounted
+#define EVENTS_TIME_VALID_EPOCH 1704067200  // 2024-01-01, older clocks are not set
+#define EVENT_FLAG_UPTIME 0x80  // on type: time is seconds since boot, the clock wasn't set
+
+enum EventType : uint8_t {
+  EVENT_BOOT = 1,    // aux: reset reason
+  EVENT_ALARM = 2,   // aux: alarm time (minutes of the day)
+  EVENT_PUMP = 3,    // aux: PWM angle, value: running time (ms)
+  EVENT_SENSOR = 4,  // aux: pin, value: ADC raw value
+};
+
+// Compact event record, written once on erased flash. The type may carry EVENT_FLAG_UPTIME.
+struct EventRecord {
+  uint32_t time;
+  uint32_t value;
+  uint16_t aux;
+  uint8_t type;
+  uint8_t crc;
+};
+
+static_assert(sizeof(EventRecord) == 12, "EventRecord must be packed in 12 bytes");
+
+/**
+ * @brief Durable outbound event queue
+ * @details Raw log on its own data partition (EVENTS_PARTITION_LABEL), the SPIFFS one is
+ * left alone. It uses EVENTS_SECTORS sectors as a ring. Each sector starts with a header with its
+ * sequence number, then the records. When the ring is full the oldest sector is erased
+ * and its unsent events are counted as lost. Event ids are sequence * records per sector
+ * + index, and the id of the first unsent event (cursor) is kept in NVS.
+ * Events added before begin() are kept in RAM and written when the log is mounted, so
+ * mounting can wait until the boot is done. The public methods are guarded by a mutex,
+ * events are added on the loop task and read by the uploader task.
+ */
+class EventStore {
+ private:
+  struct SectorHeader {
+    uint32_t magic;
+    uint32_t seq;
+  };
+
+  enum : uint32_t { PER_SECTOR = (EVENTS_SECTOR_SIZE - sizeof(SectorHeader)) / sizeof(EventRecord) };
+
+  const esp_partition_t* part = nullptr;
+  uint32_t sectors = 0;
+  uint32_t headSector = 0;
+  uint32_t headSeq = 0;
+  uint32_t headIndex = 0;
+  uint32_t tailSeq = 0;
+  uint32_t cursor = 0;
+  bool cursorLoaded = false;
+  uint32_t lost = 0;
+  EventRecord early[EVENTS_EARLY_MAX];
+  uint8_t earlyCount = 0;
+  mutable std::mutex lock;
+
+  static uint8_t crc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+      crc ^= *data++;
+      for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+  }
+
+  size_t slotOffset(uint32_t sector, uint32_t index) const {
+    return sector * EVENTS_SECTOR_SIZE + sizeof(SectorHeader) + index * sizeof(EventRecord);
+  }
+
+  bool isSlotErased(uint32_t sector, uint32_t index) const {
+    uint8_t raw[sizeof(EventRecord)];
+    if (esp_partition_read(part, slotOffset(sector, index), raw, sizeof(raw)) != ESP_OK) return false;
+    for (uint8_t b : raw) {
+      if (b != 0xFF) return false;
+    }
+    return true;
+  }
+
+  bool startSector(uint32_t sector, uint32_t seq) {
+    if (esp_partition_erase_range(part, sector * EVENTS_SECTOR_SIZE, EVENTS_SECTOR_SIZE) != ESP_OK)
+      return false;
+    SectorHeader header = {EVENTS_SECTOR_MAGIC, seq};
+    if (esp_partition_write(part, sector * EVENTS_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+      return false;
+    headSector = sector;
+    headSeq = seq;
+    headIndex = 0;
+    return true;
+  }
+
+  bool write(const EventRecord& rec) {
+    if (headIndex >= PER_SECTOR && !advance()) return false;
+    if (esp_partition_write(part, slotOffset(headSector, headIndex), &rec, sizeof(rec)) != ESP_OK)
+      return false;
+    headIndex++;
+    return true;
+  }
+
+  // Move the head to the next sector, evicting the oldest one if the ring is full
+  bool advance() {
+    uint32_t next = (headSector + 1) % sectors;
+    SectorHeader header;
+    esp_partition_read(part, next * EVENTS_SECTOR_SIZE, &header, sizeof(header));
+    if (header.magic == EVENTS_SECTOR_MAGIC) {
+      uint32_t end = (header.seq + 1) * PER_SECTOR;
+      uint32_t from = max(currentCursor(), header.seq * PER_SECTOR);
+      if (end > from) lost += end - from;
+      tailSeq = header.seq + 1;
+    }
+    return startSector(next, headSeq + 1);
+  }
+
+  uint32_t headId() const { return headSeq * PER_SECTOR + headIndex; }
+
+  uint32_t currentCursor() {
+    if (!cursorLoaded) {
+      Preferences prefs;
+      prefs.begin("event_store", true);
+      cursor = prefs.getUInt("cursor", 0);
+      prefs.end();
+      cursorLoaded = true;
+    }
+    if (cursor > headId()) cursor = 0;  // the log was erased
+    return max(cursor, tailSeq * PER_SECTOR);
+  }
+
+  // Find the newest sector and its first free slot
+  bool mount() {
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, EVENTS_PARTITION_LABEL);
+    if (!part) return false;
+    sectors = min((uint32_t)EVENTS_SECTORS, (uint32_t)(part->size / EVENTS_SECTOR_SIZE));
+    if (sectors < 2) {
+      part = nullptr;
+      return false;
+    }
+
+    headSeq = 0;
+    tailSeq = UINT32_MAX;
+    for (uint32_t i = 0; i < sectors; i++) {
+      SectorHeader header;
+      esp_partition_read(part, i * EVENTS_SECTOR_SIZE, &header, sizeof(header));
+      if (header.magic != EVENTS_SECTOR_MAGIC) continue;
+      if (header.seq > headSeq) {
+        headSeq = header.seq;
+        headSector = i;
+      }
+      if (header.seq < tailSeq) tailSeq = header.seq;
+    }
+
+    if (headSeq == 0) {
+      tailSeq = 1;
+      if (!startSector(0, 1)) part = nullptr;
+      return part != nullptr;
+    }
+
+    // Records are contiguous on a sector, binary search of the first erased slot
+    uint32_t lo = 0, hi = PER_SECTOR;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if (isSlotErased(headSector, mid))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    headIndex = lo;
+    return true;
+  }
+
+ public:
+  /**
+   * @brief mount the log, it only reads the sector headers and a few slots,
+   * then writes the events added before
+   * @return false if there is no data partition for it
+   */
+  bool begin() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!mount()) return false;
+    for (uint8_t i = 0; i < earlyCount; i++) write(early[i]);
+    earlyCount = 0;
+    return true;
+  }
+
+  bool isReady() const { return part != nullptr; }
+
+  /**
+   * @brief append an event. Corrupted (torn) records are skipped on read.
+   * @details Without a valid clock the time is the uptime and EVENT_FLAG_UPTIME is set.
+   */
+  bool add(EventType type, uint16_t aux, uint32_t value) {
+    time_t now = time(nullptr);
+    EventRecord rec = {(uint32_t)now, value, aux, type, 0};
+    if (now < EVENTS_TIME_VALID_EPOCH) {
+      rec.time = millis() / 1000;
+      rec.type |= EVENT_FLAG_UPTIME;
+    }
+    rec.crc = crc8(reinterpret_cast<const uint8_t*>(&rec), sizeof(rec) - 1);
+    std::lock_guard<std::mutex> guard(lock);
+    if (part) return write(rec);
+    if (earlyCount >= EVENTS_EARLY_MAX) return false;
+    early[earlyCount++] = rec;
+    return true;
+  }
+
+  /**
+   * @brief read the event with the given id
+   * @return false if it was evicted, not written yet or corrupted
+   */
+  bool read(uint32_t id, EventRecord& rec) const {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!part) return false;
+    uint32_t seq = id / PER_SECTOR;
+    uint32_t index = id % PER_SECTOR;
+    if (seq < tailSeq || seq > headSeq || (seq == headSeq && index >= headIndex)) return false;
+    uint32_t sector = (headSector + sectors - (headSeq - seq)) % sectors;
+    if (esp_partition_read(part, slotOffset(sector, index), &rec, sizeof(rec)) != ESP_OK) return false;
+    return rec.type != 0xFF && rec.crc == crc8(reinterpret_cast<const uint8_t*>(&rec), sizeof(rec) - 1);
+  }
+
+  uint32_t firstId() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return tailSeq * PER_SECTOR;
+  }
+
+  uint32_t nextId() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return headId();
+  }
+
+  /**
+   * @brief id of the first event not acknowledged by the collector
+   */
+  uint32_t getCursor() {
+    std::lock_guard<std::mutex> guard(lock);
+    return currentCursor();
+  }
+
+  /**
+   * @brief mark all events before the given id as delivered
+   */
+  void ack(uint32_t next) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (next <= currentCursor() || next > headId()) return;
+      cursor = next;
+    }
+    // NVS write out of the lock, add() doesn't wait for it
+    Preferences prefs;
+    prefs.begin("event_store", false);
+    prefs.putUInt("cursor", next);
+    prefs.end();
+  }
+
+  uint32_t pending() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!part) return 0;
+    return headId() - currentCursor();
+  }
+
+  uint32_t getLost() const { return lost; }
+};
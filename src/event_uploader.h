@@ -0,0 +1,195 @@
+#pragma once
+
+#include <HTTPClient.h>
+#include <WiFi.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "event_store.h"
+
+#ifndef EVENTS_BATCH_MAX
+#define EVENTS_BATCH_MAX 256  // events per POST
+#endif
+#define EVENTS_BATCH_MAGIC "BPE1"
+#define EVENTS_RECORD_MAX_LEN 19  // worst case of an encoded event
+#define EVENTS_HEADER_MAX_LEN 14
+#define EVENTS_HTTP_TIMEOUT 5000
+#define EVENTS_RETRY_MIN 5000
+#define EVENTS_RETRY_MAX (5 * 60 * 1000)
+#define EVENTS_TASK_STACK 8192
+#define EVENTS_POLL_INTERVAL 1000
+
+/**
+ * @brief Batched upload of the event queue to a local collector
+ * @details Each POST carries up to EVENTS_BATCH_MAX events, delta and varint encoded
+ * (application/octet-stream):
+ *
+ *   "BPE1" | first id | base time | events (id delta, type, time delta, aux, value) until the end
+ *
+ * All numbers are LEB128 varints, type is one byte and time deltas are zigzag encoded.
+ * Types with EVENT_FLAG_UPTIME carry seconds since boot instead of epoch time.
+ * The collector replies 200 with the next event id it expects, in decimal, and only
+ * those events are removed from the queue. A collector that already stored the batch
+ * (its previous reply was lost) may reply with a later id. Failures are retried with exponential backoff.
+ * Uploads run on their own task, a slow collector never delays the loop (alarms, CLI).
+ */
+class EventUploader {
+ private:
+  EventStore& store;
+  String url;
+  std::mutex urlLock;
+  std::atomic<bool> requested{false};
+  uint32_t nextTry = 0;  // nextTry and backoff are only used by the upload task
+  uint32_t backoff = EVENTS_RETRY_MIN;
+  std::atomic<uint32_t> sent{0};
+  std::atomic<uint32_t> failures{0};
+  uint8_t buffer[EVENTS_HEADER_MAX_LEN + EVENTS_BATCH_MAX * EVENTS_RECORD_MAX_LEN];
+
+  static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t len = 0;
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      out[len++] = value ? byte | 0x80 : byte;
+    } while (value);
+    return len;
+  }
+
+  static uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+
+  void retryLater() {
+    failures++;
+    nextTry = millis() + backoff;
+    backoff = min(backoff * 2, (uint32_t)EVENTS_RETRY_MAX);
+  }
+
+ public:
+  static void task(void* param) {
+    EventUploader* self = static_cast<EventUploader*>(param);
+    for (;;) {
+      if (!self->upload()) vTaskDelay(pdMS_TO_TICKS(EVENTS_POLL_INTERVAL));
+    }
+  }
+
+  /**
+   * @brief send one batch if due
+   * @return true if there are more events to send right away
+   */
+  bool upload() {
+    if (!requested) {
+      backoff = EVENTS_RETRY_MIN;
+      nextTry = millis();
+      return false;
+    }
+    if (!WiFi.isConnected() || (int32_t)(millis() - nextTry) < 0) return false;
+    String target = getUrl();
+    if (target.isEmpty()) return false;
+    if (store.pending() == 0) {
+      requested = false;
+      if (store.pending() == 0) return false;
+      requested = true;  // an event was added meanwhile
+    }
+
+    uint32_t first = store.getCursor();
+    uint32_t next;
+    size_t len = encode(first, next);
+    if (len == 0) {  // only corrupted events, nothing to send
+      store.ack(next);
+      return true;
+    }
+
+    HTTPClient http;
+    http.setConnectTimeout(EVENTS_HTTP_TIMEOUT);
+    http.setTimeout(EVENTS_HTTP_TIMEOUT);
+    if (!http.begin(target)) {
+      retryLater();
+      return false;
+    }
+    http.addHeader("Content-Type", "application/octet-stream");
+    http.addHeader("X-Device", WiFi.getHostname());
+    int code = http.POST(buffer, len);
+    uint32_t acked = code == HTTP_CODE_OK ? strtoul(http.getString().c_str(), nullptr, 10) : 0;
+    http.end();
+
+    if (acked > next) acked = next;  // the collector already has these events
+    if (acked <= first) {
+      retryLater();
+      return false;
+    }
+    store.ack(acked);
+    sent += acked - first;
+    backoff = EVENTS_RETRY_MIN;
+    return true;
+  }
+
+ public:
+  explicit EventUploader(EventStore& eventStore) : store(eventStore) {}
+
+  /**
+   * @brief start the upload task
+   */
+  bool begin() {
+    return xTaskCreate(task, "uploader", EVENTS_TASK_STACK, this, 1, nullptr) == pdPASS;
+  }
+
+  void setUrl(const String& collectorUrl) {
+    std::lock_guard<std::mutex> guard(urlLock);
+    url = collectorUrl;
+  }
+
+  String getUrl() {
+    std::lock_guard<std::mutex> guard(urlLock);
+    return url;
+  }
+
+  /**
+   * @brief start draining the queue, i.e. when the WiFi is connected or an event is added
+   */
+  void requestUpload() { requested = true; }
+
+  /**
+   * @brief encode the next batch
+   * @param next id after the last scanned event (corrupted events are skipped)
+   * @return encoded length, 0 if there are no valid events to send
+   */
+  size_t encode(uint32_t first, uint32_t& next) {
+    uint32_t last = store.nextId();
+    uint32_t count = 0;
+    uint32_t prevId = 0;
+    uint32_t prevTime = 0;
+    size_t len = 0;
+    EventRecord rec;
+    for (next = first; next < last && count < EVENTS_BATCH_MAX; next++) {
+      if (!store.read(next, rec)) continue;
+      if (count == 0) {
+        memcpy(buffer, EVENTS_BATCH_MAGIC, 4);
+        len = 4;
+        len += putVarint(buffer + len, next);
+        len += putVarint(buffer + len, rec.time);
+        prevId = next;
+        prevTime = rec.time;
+      }
+      len += putVarint(buffer + len, next - prevId);
+      buffer[len++] = rec.type;
+      len += putVarint(buffer + len, zigzag((int32_t)(rec.time - prevTime)));
+      len += putVarint(buffer + len, rec.aux);
+      len += putVarint(buffer + len, rec.value);
+      prevId = next;
+      prevTime = rec.time;
+      count++;
+    }
+    return len;
+  }
+
+  const uint8_t* getBatch() const { return buffer; }
+
+  void printStatus(Stream* response) {
+    String target = getUrl();
+    response->printf("collector: \t%s\r\n", target.isEmpty() ? "(not set)" : target.c_str());
+    response->printf("queued: \t%u\r\n", (unsigned)store.pending());
+    response->printf("sent: \t\t%u\r\n", (unsigned)sent.load());
+    response->printf("lost: \t\t%u\r\n", (unsigned)store.getLost());
+    response->printf("failures: \t%u\r\n", (unsigned)failures.load());
+  }
+};
@@ -15,6 +15,10 @@
 
 #include "OneButton.h"
 #include "alarm_manager.h"
+#include "boot_state.h"
+#include "console_mux.h"
+#include "event_store.h"
+#include "event_uploader.h"
 #include "esp_sntp.h"
 #include "logo.h"
 #include "app_config.h"
@@ -25,12 +29,28 @@
 // Global alarm manager instance
 AlarmManager alarmManager;
 
+// Event log fan-out to Serial and Telnet sessions
+ConsoleMux console;
+
+// Boot phases timing
+BootTimer bootTimer;
+
+// Outbound events queue on flash and its collector upload
+EventStore events;
+EventUploader uploader(events);
+
 OneButton button1(PIN_BUTTON_1, true);
 
 const char *key_ntp_server = "kntpserver";
 const char *key_tzone = "ktzone";
+const char *key_collector = "kcollector";
 
-bool wcli_setup_ready = false;
+volatile bool wcli_setup_ready = false;
+bool network_started = false;
+volatile bool network_ready = false;
+bool ota_ready = false;
+bool schedule_from_rtc = false;
+volatile bool ntp_synced = false;
 
 Servo pumpServo1, pumpServo2;
 
@@ -39,24 +59,35 @@ Servo pumpServo1, pumpServo2;
  * @details This class handles the WiFi status and command line interface (CLI) events.
  */
 class mESP32WifiCLICallbacks : public ESP32WifiCLICallbacks {
-  void onWifiStatus(bool isConnected) {}
+  void onWifiStatus(bool isConnected) {
+    if (isConnected) uploader.requestUpload();
+  }
   void onHelpShow() {}
   void onNewWifi(String ssid, String passw) { wcli_setup_ready = wcli.isConfigured(); }
 };
 
-void enablePump(char *args, Stream *response) {
-  Pair<String, String> operands = wcli.parseCommand(args);
-  String angle = operands.first();
-  String time = operands.second();
-  response->printf("Pump enabled for %s PWM for %s ms\r\n", angle.c_str(), time.c_str());
+/**
+ * @brief queue an event for the collector
+ * @details It is uploaded now if the WiFi is connected, otherwise on the next connection.
+ */
+void logEvent(EventType type, uint16_t aux, uint32_t value) {
+  if (events.add(type, aux, value)) uploader.requestUpload();
+}
 
+/**
+ * @brief run the pump
+ * @param angle servo PWM angle (only for servo pumps)
+ * @param time running time in ms
+ */
+void runPump(int angle, uint32_t time) {
+  logEvent(EVENT_PUMP, angle, time);
   // TODO: migrate it to class object
   #ifdef PUMP_TYPE_SERVO
   pumpServo1.attach(PIN_PUMP_1);
   pumpServo2.attach(PIN_PUMP_2);
-  pumpServo1.write(angle.toInt());
-  pumpServo2.write(angle.toInt());
-  delay(time.toDouble());  // TODO: migrate it to task (not blocking)
+  pumpServo1.write(angle);
+  pumpServo2.write(angle);
+  delay(time);  // TODO: migrate it to task (not blocking)
   pumpServo1.write(PUMP_ANGLE_STOP);
   pumpServo2.write(PUMP_ANGLE_STOP);
   pumpServo1.detach();
@@ -64,27 +95,70 @@ void enablePump(char *args, Stream *response) {
   #else
   digitalWrite(PIN_PUMP_1, HIGH);
   digitalWrite(PIN_PUMP_2, HIGH);
-  delay(time.toDouble());  // TODO: migrate it to task (not blocking)
+  delay(time);  // TODO: migrate it to task (not blocking)
   digitalWrite(PIN_PUMP_1, LOW);
   digitalWrite(PIN_PUMP_2, LOW); 
   #endif
 }
 
+void enablePump(char *args, Stream *response) {
+  Pair<String, String> operands = wcli.parseCommand(args);
+  String angle = operands.first();
+  String time = operands.second();
+  response->printf("Pump enabled for %s PWM for %s ms\r\n", angle.c_str(), time.c_str());
+  runPump(angle.toInt(), time.toInt());
+}
+
 /**
  * @brief Callback function for alarm triggered event
  * @param alarmName Name of the triggered alarm
  * @param timeinfo Pointer to the tm structure containing the current time
  */
 void alarmTriggered(const char *alarmName, const tm *timeinfo) {
-  Serial.printf("\r\nALARM TRIGGERED [%02d:%02d]: %s\r\n", timeinfo->tm_hour, timeinfo->tm_min,
-                alarmName);
-  enablePump((char *)"250 30000", &Serial);  // enable pump for 15 second
+  console.printf("ALARM TRIGGERED [%02d:%02d]: %s", timeinfo->tm_hour, timeinfo->tm_min, alarmName);
+  logEvent(EVENT_ALARM, timeinfo->tm_hour * 60 + timeinfo->tm_min, 0);
+  console.drain();  // show it before the pump blocks the loop
+  runPump(250, 30000);  // enable pump for 30 seconds
 }
 
 /**
  * @brief test the pump
  */
-void testPump() { enablePump((char *)"120 15000", &Serial); }
+void testPump() {
+  console.println("Pump test for 120 PWM for 15000 ms");
+  console.drain();
+  runPump(120, 15000);
+}
+
+/**
+ * @brief keep the schedule, timezone and current time in RTC memory for the next boot
+ */
+void saveBootSnapshot() {
+  const char *tzone = getenv("TZ");
+  saveBootState(alarmManager, tzone ? tzone : DEFAULT_TZONE);
+}
+
+/**
+ * @brief open the preferences storage, only once
+ */
+void initPreferences() {
+  static bool cfg_ready = false;
+  if (cfg_ready) return;
+  cfg.init("basil_plant");
+  cfg_ready = true;
+}
+
+/**
+ * @brief update the timezone from the preferences
+ */
+void updateTimeZone() {
+  String tzone = wcli.getString(key_tzone, DEFAULT_TZONE);
+  console.printf("timezone: \t%s", tzone.c_str());
+  const char *current = getenv("TZ");
+  if (current && tzone == current) return;  // already restored from RTC memory
+  setenv("TZ", tzone.c_str(), 1);
+  tzset();
+}
 
 /**
  * @brief update the time settings
@@ -92,11 +166,9 @@ void testPump() { enablePump((char *)"120 15000", &Serial); }
  */
 void updateTimeSettings() {
   String server = wcli.getString(key_ntp_server, NTP_SERVER1);
-  String tzone = wcli.getString(key_tzone, DEFAULT_TZONE);
-  Serial.printf("ntp server: \t%s\r\ntimezone: \t%s\r\n", server.c_str(), tzone.c_str());
+  console.printf("ntp server: \t%s", server.c_str());
   configTime(GMT_OFFSET_SEC, DAY_LIGHT_OFFSET_SEC, server.c_str(), NTP_SERVER2);
-  setenv("TZ", tzone.c_str(), 1);
-  tzset();
+  updateTimeZone();
 }
 
 /**
@@ -109,11 +181,12 @@ void setNTPServer(char *args, Stream *response) {
   Pair<String, String> operands = wcli.parseCommand(args);
   String server = operands.first();
   if (server.isEmpty()) {
-    Serial.println(wcli.getString(key_ntp_server, NTP_SERVER1));
+    response->println(wcli.getString(key_ntp_server, NTP_SERVER1));
     return;
   }
   wcli.setString(key_ntp_server, server);
   updateTimeSettings();
+  response->printf("ntp server: \t%s\r\n", server.c_str());
 }
 
 /**
@@ -126,11 +199,13 @@ void setTimeZone(char *args, Stream *response) {
   Pair<String, String> operands = wcli.parseCommand(args);
   String tzone = operands.first();
   if (tzone.isEmpty()) {
-    Serial.println(wcli.getString(key_tzone, DEFAULT_TZONE));
+    response->println(wcli.getString(key_tzone, DEFAULT_TZONE));
     return;
   }
   wcli.setString(key_tzone, tzone);
   updateTimeSettings();
+  saveBootSnapshot();
+  response->printf("timezone: \t%s\r\n", tzone.c_str());
 }
 
 /**
@@ -226,6 +301,7 @@ void addAlarm(char *args, Stream *response) {
 
   alarmManager.addDailyAlarm(hour, minute, safeName);
   alarmManager.saveAlarms();  // Save to preferences
+  saveBootSnapshot();
   response->printf("Added alarm: %02d:%02d - %s\r\n", hour, minute, safeName);
 }
 
@@ -251,6 +327,7 @@ void dropAlarm(char *args, Stream *response) {
 
   if (alarmManager.deleteAlarmByName(name.c_str())) {
     alarmManager.saveAlarms();  // Save to preferences
+    saveBootSnapshot();
     response->printf("Removed alarm: %s\r\n", name.c_str());
   } else {
     response->printf("No alarm found with name: %s\r\n", name.c_str());
@@ -259,16 +336,20 @@ void dropAlarm(char *args, Stream *response) {
 
 /**
  * @brief check for triggered alarms
- * @details This function checks for triggered alarms every second.
+ * @details This function checks for triggered alarms every second, starting on the
+ * first loop. It never waits for NTP, without a valid clock it only skips the check.
  */
 void checkAlarms() {
   static uint32_t last_tick;
-  if (millis() - last_tick > 1000) {
-    struct tm timeinfo;
-    getLocalTime(&timeinfo);
-    alarmManager.checkAlarms(&timeinfo);
-    last_tick = millis();
-  }
+  static bool ticking = false;
+  if (ticking && millis() - last_tick < 1000) return;
+  ticking = true;
+  last_tick = millis();
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo, 0)) return;
+  bootTimer.mark("schedule");
+  alarmManager.checkAlarms(&timeinfo);
+  saveBootSnapshot();
 }
 
 /**
@@ -285,14 +366,81 @@ void getADCVal(char *args, Stream *response) {
     return;
   }
   int adcVal = analogRead(pin);
+  logEvent(EVENT_SENSOR, pin, adcVal);
   double voltage = adcVal / 4095.0 * 3.3;  //Convert to the voltage value at the detection point.
   double battery = voltage * 4.0;          //There is only 1/4 battery voltage at the detection point.
   response->printf("ADC Val: %d, \t Voltage: %.2fV, \t Battery: %.2fV\r\n", adcVal, voltage, battery);
 }
 
+/**
+ * @brief subscribe the current console to the event log
+ * @param args on | off (empty to show the sessions status)
+ * @param response Stream to send response to Serial or Telnet console
+ * @details The command format is: console [on|off]
+ */
+void setConsole(char *args, Stream *response) {
+  Pair<String, String> operands = wcli.parseCommand(args);
+  String mode = operands.first();
+  if (mode == "on") {
+    int fd = -1;
+    if (response->availableForWrite() <= 0) {
+      // network streams don't report their buffer, write on the Telnet socket instead
+      fd = ConsoleMux::findClientSocket(CLI_TELNET_PORT);
+      if (fd < 0) {
+        response->println("Error: Telnet session socket not found");
+        return;
+      }
+    }
+    if (!console.attach(response, fd)) response->println("Error: no free console sessions");
+  } else if (mode == "off") {
+    console.detach(response);
+  } else if (!mode.isEmpty()) {
+    response->println("Usage: console [on|off]");
+    return;
+  }
+  response->printf("events log: \t%s\r\n", console.isAttached(response) ? "on" : "off");
+  console.printStatus(response);
+}
+
+/**
+ * @brief show the boot phases timing
+ * @param args Command line arguments (not used)
+ * @param response Stream to send response to Serial or Telnet console
+ */
+void printBootInfo(char *args, Stream *response) {
+  response->printf("reset reason: \t%d\r\n", esp_reset_reason());
+  response->printf("schedule from: \t%s\r\n", schedule_from_rtc ? "RTC memory" : "flash");
+  bootTimer.print(response);
+}
+
+/**
+ * @brief set the events collector URL
+ * @param args collector URL, i.e. http://192.168.1.10:8080/events (empty to show the status)
+ * @param response Stream to send response to Serial or Telnet console
+ * @details The command format is: collector <url>
+ */
+void setCollector(char *args, Stream *response) {
+  Pair<String, String> operands = wcli.parseCommand(args);
+  String url = operands.first();
+  if (!url.isEmpty()) {
+    if (!url.startsWith("http://")) {
+      response->println("Error: the collector URL must start with http://");
+      return;
+    }
+    wcli.setString(key_collector, url);
+    uploader.setUrl(url);
+    uploader.requestUpload();
+  }
+  uploader.printStatus(response);
+}
+
 void enableOTA() {
   ota.setup(WiFi.getHostname(), "basil_plant");
-  ota.setOnUpdateMessageCb([](const char *msg) { Serial.println(msg); });
+  // ArduinoOTA.handle() blocks until the update ends, drain from the callback
+  ota.setOnUpdateMessageCb([](const char *msg) {
+    console.println(msg);
+    console.drain();
+  });
 }
 
 void initRemoteShell() {
@@ -301,20 +449,17 @@ void initRemoteShell() {
 #endif
 }
 
-void setup() {
-  Serial.begin(115200);
-  button1.attachClick([]() { testPump(); });
-
-  cfg.init("basil_plant");
-  
+/**
+ * @brief second boot stage: CLI, WiFi and NTP
+ * @details It runs on its own task, started after the first alarms check, so loop()
+ * keeps checking alarms while WiFi associates. loop() doesn't touch the CLI until
+ * network_ready is set.
+ */
+void networkTask(void *param) {
+  initPreferences();
   wcli.setCallback(new mESP32WifiCLICallbacks());
   wcli.shell->attachLogo(logo);
   wcli.setSilentMode(true);
-  // NTP init
-  updateTimeSettings();
-  // Initialize alarm callback
-  alarmManager.setCallback(alarmTriggered);
-  alarmManager.loadAlarms();
   // CLI config
   wcli.add("ntpserver", &setNTPServer, "\tset NTP server. Default: pool.ntp.org");
   wcli.add("ntpzone", &setTimeZone, "\tset TZONE. https://tinyurl.com/4s44uyzn");
@@ -324,11 +469,41 @@ void setup() {
   wcli.add("addalarm", &addAlarm, "\t<HH:MM> <Alarm Name> add alarm");
   wcli.add("dropalarm", &dropAlarm, "\t<Alarm Name> remove alarm");
   wcli.add("getADCVal", &getADCVal, "\t<PIN> get ADC voltage");
+  wcli.add("console", &setConsole, "\t[on|off] events log on this console");
+  wcli.add("boot", &printBootInfo, "\t\tshow boot phases timing");
+  wcli.add("collector", &setCollector, "\t<URL> set events collector. Show the queue status");
+  uploader.setUrl(wcli.getString(key_collector, ""));
   wcli_setup_ready = wcli.isConfigured();
   wcli.begin("basil_plant");
   initRemoteShell();
+  // NTP init
+  sntp_set_time_sync_notification_cb([](struct timeval *tv) { ntp_synced = true; });
+  updateTimeSettings();
+  network_ready = true;
+  vTaskDelete(nullptr);
+}
+
+void setup() {
+  bootTimer.mark("setup");
+  // Pump safety first, outputs off before anything else
+  pinMode(PIN_PUMP_1, GPIO_MODE_OUTPUT);
+  pinMode(PIN_PUMP_2, GPIO_MODE_OUTPUT);
+  digitalWrite(PIN_PUMP_1, LOW);
+  digitalWrite(PIN_PUMP_2, LOW);
+
+  Serial.begin(115200);
+  console.attach(&Serial);
+  button1.attachClick([]() { testPump(); });
 
-  if (wcli_setup_ready) enableOTA();
+  // Initialize alarm callback and schedule, RTC memory first, flash as fallback
+  alarmManager.setCallback(alarmTriggered);
+  alarmManager.setSaveCallback(saveBootSnapshot);
+  schedule_from_rtc = restoreBootState(alarmManager);
+  if (!schedule_from_rtc) {
+    initPreferences();
+    alarmManager.loadAlarms();
+    updateTimeZone();
+  }
 
   // Allow allocation of all timers
   ESP32PWM::allocateTimer(0);
@@ -336,17 +511,29 @@ void setup() {
   ESP32PWM::allocateTimer(2);
   ESP32PWM::allocateTimer(3);
 
-  // Set up the pump servo
-  pinMode(PIN_PUMP_1, GPIO_MODE_OUTPUT);
-  pinMode(PIN_PUMP_2, GPIO_MODE_OUTPUT);
-  digitalWrite(PIN_PUMP_1, LOW);
-  digitalWrite(PIN_PUMP_2, LOW);
+  logEvent(EVENT_BOOT, esp_reset_reason(), 0);  // only queued in RAM until the log is mounted
+  bootTimer.mark("core");
 }
 
 void loop() {
-  wcli.loop();
   button1.tick();
+  checkAlarms();  // scheduling never waits for the network stage
+  console.drain();
+  if (!network_started) {
+    network_started = true;
+    events.begin();
+    uploader.begin();
+    xTaskCreate(networkTask, "network", 8192, nullptr, 1, nullptr);
+  }
+  if (!network_ready) return;
+  bootTimer.mark("network");
+  wcli.loop();
+  if (ntp_synced) bootTimer.mark("ntp sync");
   if (!wcli_setup_ready) return; // Only run services if WiFi setup is ready
-  ota.loop();
-  checkAlarms(); 
+  if (!ota_ready && WiFi.isConnected()) {
+    enableOTA();
+    ota_ready = true;
+    bootTimer.mark("ota");
+  }
+  if (ota_ready) ota.loop();
 }
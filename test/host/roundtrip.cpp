@@ -0,0 +1,58 @@
+/**
+ * Host harness for test_wire_format.py: it queues a known set of events on
+ * EventStore, then prints them and the batches encoded by EventUploader.
+ *
+ *   event <type> <time> <aux> <value>
+ *   batch <first id> <next id> <hex>
+ */
+#include <cinttypes>
+
+#include "event_uploader.h"
+
+uint32_t hostMillis = 0;
+time_t hostTime = 0;
+uint32_t Preferences::value = 0;
+esp_partition_t hostPartition = {EVENTS_SECTORS * EVENTS_SECTOR_SIZE};
+std::vector<uint8_t> hostFlash(EVENTS_SECTORS* EVENTS_SECTOR_SIZE, 0xFF);
+HostWiFi WiFi;
+
+static EventStore store;
+static EventUploader uploader(store);
+
+static void add(EventType type, uint16_t aux, uint32_t value, uint8_t expectedType, uint32_t expectedTime) {
+  if (!store.add(type, aux, value)) return;
+  printf("event %u %" PRIu32 " %u %" PRIu32 "\n", expectedType, expectedTime, aux, value);
+}
+
+int main() {
+  // Before the log is mounted and without a clock: uptime seconds and the flag
+  hostMillis = 3500;
+  add(EVENT_BOOT, 1, 0, EVENT_BOOT | EVENT_FLAG_UPTIME, 3);
+  hostMillis = 4200;
+  add(EVENT_ALARM, 360, 0, EVENT_ALARM | EVENT_FLAG_UPTIME, 4);
+  store.begin();
+
+  // Synced clock, more events than a sector and a batch
+  hostTime = 1760000000;
+  for (int i = 0; i < 700; i++) {
+    if (i % 2)
+      add(EVENT_PUMP, 250, 30000, EVENT_PUMP, hostTime);
+    else
+      add(EVENT_SENSOR, 14, 1800 + i, EVENT_SENSOR, hostTime);
+    hostTime += 37;
+  }
+  hostTime -= 5000;  // NTP stepped the clock back
+  add(EVENT_PUMP, 120, 15000, EVENT_PUMP, hostTime);
+  add(EVENT_SENSOR, UINT16_MAX, UINT32_MAX, EVENT_SENSOR, hostTime);
+
+  while (store.pending()) {
+    uint32_t first = store.getCursor();
+    uint32_t next;
+    size_t len = uploader.encode(first, next);
+    printf("batch %" PRIu32 " %" PRIu32 " ", first, next);
+    for (size_t i = 0; i < len; i++) printf("%02x", uploader.getBatch()[i]);
+    printf("\n");
+    store.ack(next);
+  }
+  return 0;
+}
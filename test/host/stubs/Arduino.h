@@ -0,0 +1,37 @@
+// Minimal Arduino and FreeRTOS stand-ins to build the event queue on the host
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+using std::max;
+using std::min;
+
+struct String : std::string {
+  String() {}
+  String(const char* str) : std::string(str) {}
+  String(const std::string& str) : std::string(str) {}
+  bool isEmpty() const { return empty(); }
+};
+
+struct Stream {
+  int printf(const char*, ...) { return 0; }
+};
+
+// Clock of the host test: millis() and time() return these
+extern uint32_t hostMillis;
+extern time_t hostTime;
+
+inline uint32_t millis() { return hostMillis; }
+inline time_t hostTimeNow(time_t*) { return hostTime; }
+#define time(arg) hostTimeNow(arg)
+
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) (ms)
+inline int xTaskCreate(void (*)(void*), const char*, uint32_t, void*, int, void*) { return pdPASS; }
+inline void vTaskDelay(uint32_t) {}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// Single value store, the event queue only keeps its cursor here
+class Preferences {
+ public:
+  static uint32_t value;
+  bool begin(const char*, bool) { return true; }
+  void end() {}
+  uint32_t getUInt(const char*, uint32_t) { return value; }
+  size_t putUInt(const char*, uint32_t newValue) {
+    value = newValue;
+    return sizeof(newValue);
+  }
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+class HostWiFi {
+ public:
+  bool isConnected() { return false; }
+  const char* getHostname() { return "host"; }
+};
+
+extern HostWiFi WiFi;
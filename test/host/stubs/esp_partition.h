@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Flash partition in RAM: erase sets 0xFF, writes can only clear bits
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+enum { ESP_PARTITION_TYPE_DATA = 1 };
+enum { ESP_PARTITION_SUBTYPE_ANY = 0xff };
+
+struct esp_partition_t {
+  uint32_t size;
+};
+
+extern esp_partition_t hostPartition;
+extern std::vector<uint8_t> hostFlash;
+
+inline const esp_partition_t* esp_partition_find_first(int, int, const char*) { return &hostPartition; }
+
+inline esp_err_t esp_partition_read(const esp_partition_t* part, size_t offset, void* dst, size_t len) {
+  if (offset + len > part->size) return ESP_FAIL;
+  memcpy(dst, hostFlash.data() + offset, len);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t* part, size_t offset, const void* src, size_t len) {
+  if (offset + len > part->size) return ESP_FAIL;
+  const uint8_t* data = static_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < len; i++) hostFlash[offset + i] &= data[i];
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t len) {
+  if (offset + len > part->size) return ESP_FAIL;
+  memset(hostFlash.data() + offset, 0xFF, len);
+  return ESP_OK;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""
+Host round trip of the events wire format: EventStore + EventUploader::encode
+(roundtrip.cpp, built with g++ against the stubs) -> tools/collector.py
+
+usage: python3 test/host/test_wire_format.py
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+sys.path.insert(0, os.path.join(ROOT, "tools"))
+
+import collector  # noqa: E402
+
+BATCH_MAX = 256
+
+
+def run_harness():
+    """Returns (expected events, [(first id, next id, batch bytes)])"""
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = os.path.join(tmp, "roundtrip")
+        subprocess.run(["g++", "-std=gnu++11", "-Wall", "-I" + os.path.join(HERE, "stubs"),
+                        "-I" + os.path.join(ROOT, "src"), os.path.join(HERE, "roundtrip.cpp"),
+                        "-o", binary], check=True)
+        output = subprocess.run([binary], check=True, capture_output=True, text=True).stdout
+    expected, batches = [], []
+    for line in output.splitlines():
+        fields = line.split()
+        if fields[0] == "event":
+            event_type, time, aux, value = map(int, fields[1:])
+            expected.append({
+                "type": collector.TYPES[event_type & ~collector.FLAG_UPTIME],
+                "time": time,
+                "synced": not event_type & collector.FLAG_UPTIME,
+                "aux": aux,
+                "value": value,
+            })
+        elif fields[0] == "batch":
+            batches.append((int(fields[1]), int(fields[2]), bytes.fromhex(fields[3])))
+    return expected, batches
+
+
+class WireFormatTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.expected, cls.batches = run_harness()
+
+    def test_batches_cover_the_queue(self):
+        self.assertGreater(len(self.batches), 1)
+        for (_, next_id, _), (first, _, _) in zip(self.batches, self.batches[1:]):
+            self.assertEqual(next_id, first)
+
+    def test_decoded_events_match(self):
+        decoded = []
+        for first, next_id, data in self.batches:
+            events, decoded_next = collector.decode_batch(data)
+            self.assertLessEqual(len(events), BATCH_MAX)
+            self.assertEqual(events[0]["id"], first)
+            self.assertEqual(decoded_next, next_id)
+            decoded += events
+        ids = [event.pop("id") for event in decoded]
+        self.assertEqual(ids, list(range(ids[0], ids[0] + len(ids))))
+        self.assertEqual(decoded, self.expected)
+
+    def test_resent_batch_is_not_duplicated(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            out = os.path.join(tmp, "events.jsonl")
+            first_batch, _ = collector.decode_batch(self.batches[0][2])
+            second_batch, next_id = collector.decode_batch(self.batches[1][2])
+            store = collector.Collector(out)
+            self.assertEqual(store.store("plant", first_batch)[0], self.batches[0][1])
+            # the reply was lost: same batch again, then the collector restarts
+            self.assertEqual(store.store("plant", first_batch), (self.batches[0][1], 0))
+            store = collector.Collector(out)
+            self.assertEqual(store.store("plant", first_batch), (self.batches[0][1], 0))
+            self.assertEqual(store.store("plant", second_batch), (next_id, len(second_batch)))
+            self.assertEqual(store.store("other", first_batch)[1], len(first_batch))
+            with open(out) as lines:
+                self.assertEqual(sum(1 for _ in lines), 2 * len(first_batch) + len(second_batch))
+
+
+if __name__ == "__main__":
+    unittest.main()
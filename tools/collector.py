@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Basil Plant events collector
+
+Minimal local collector for the events queue (see "Events collector" on README).
+It decodes each BPE1 batch, appends the events as JSON lines to a file and replies
+with the next event id it expects. The expected id is kept per device (X-Device header)
+and rebuilt from the output file at startup, so events of a resent batch (i.e. the
+reply was lost) are skipped instead of written twice.
+
+usage: python3 tools/collector.py [--port 8080] [--out events.jsonl]
+then, on the device CLI: collector http://<your_pc_ip>:8080/events
+"""
+
+import argparse
+import json
+import os
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+MAGIC = b"BPE1"
+FLAG_UPTIME = 0x80
+TYPES = {1: "boot", 2: "alarm", 3: "pump", 4: "sensor"}
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_batch(data):
+    """Returns (events, next_id)"""
+    if data[:4] != MAGIC:
+        raise ValueError("bad magic")
+    event_id, pos = read_varint(data, 4)
+    time, pos = read_varint(data, pos)
+    events = []
+    while pos < len(data):
+        delta_id, pos = read_varint(data, pos)
+        event_type = data[pos]
+        pos += 1
+        delta_time, pos = read_varint(data, pos)
+        aux, pos = read_varint(data, pos)
+        value, pos = read_varint(data, pos)
+        event_id += delta_id
+        time = (time + unzigzag(delta_time)) & 0xFFFFFFFF
+        events.append({
+            "id": event_id,
+            "type": TYPES.get(event_type & ~FLAG_UPTIME, event_type & ~FLAG_UPTIME),
+            "time": time,
+            "synced": not event_type & FLAG_UPTIME,
+            "aux": aux,
+            "value": value,
+        })
+    if not events:
+        raise ValueError("empty batch")
+    return events, event_id + 1
+
+
+def load_expected(path):
+    """Next expected event id per device, from a previous output file"""
+    expected = {}
+    if not os.path.exists(path):
+        return expected
+    with open(path) as out:
+        for line in out:
+            try:
+                event = json.loads(line)
+                device, event_id = event["device"], event["id"]
+            except (ValueError, KeyError):
+                continue
+            expected[device] = max(expected.get(device, 0), event_id + 1)
+    return expected
+
+
+class Collector:
+    def __init__(self, out):
+        self.out = out
+        self.expected = load_expected(out)
+
+    def store(self, device, events):
+        """Appends the events not stored yet, returns the next expected id"""
+        expected = self.expected.get(device, 0)
+        new = [event for event in events if event["id"] >= expected]
+        if new:
+            with open(self.out, "a") as out:
+                for event in new:
+                    event["device"] = device
+                    out.write(json.dumps(event) + "\n")
+            expected = new[-1]["id"] + 1
+            self.expected[device] = expected
+        return expected, len(new)
+
+
+class CollectorHandler(BaseHTTPRequestHandler):
+    collector = None
+
+    def do_POST(self):
+        data = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        try:
+            events, next_id = decode_batch(data)
+        except (ValueError, IndexError) as error:
+            self.send_error(400, str(error))
+            return
+        device = self.headers.get("X-Device", "unknown")
+        expected, stored = self.collector.store(device, events)
+        skipped = len(events) - stored
+        print(f"{device}: {stored} events, {skipped} duplicated, {len(data)} bytes, next id {expected}")
+        if expected > next_id:
+            print(f"{device}: batch ends at {next_id} but {expected} was expected, was its log erased?")
+        body = str(expected).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Basil Plant events collector")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--out", default="events.jsonl", help="JSON lines output file")
+    args = parser.parse_args()
+    CollectorHandler.collector = Collector(args.out)
+    print(f"collector listening on :{args.port}, writing to {args.out}")
+    HTTPServer(("", args.port), CollectorHandler).serve_forever()
+
+
+if __name__ == "__main__":
+    main()